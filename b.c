@@ -0,0 +1,3 @@
+#define PK_REG
+#include "/root/repo/pk.h"
+void b_work(void){ PKRDEF(b_cnt); PKRCNT(b_cnt, 7); }
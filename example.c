@@ -1,6 +1,7 @@
 /* Step 1. Configure (optional) */
 #define PK_TAG "PK-EXAMPLE"
 #define PK_DUMP_WIDTH 16
+#define PK_REG
 
 /* Step 2. Include pk.h */
 #include "pk.h"
@@ -8,6 +9,11 @@
 /* unistd.h for sleeping */
 #include <unistd.h>
 
+/* registry entries are typically defined at file scope */
+PKRDEF(work_time);
+PKRDEF(work_items);
+PKRDEF(work_rate);
+
 struct foo {
 	int bar;
 	char *baz;
@@ -16,7 +22,7 @@ struct foo {
 int test_fn(void) { return 42; }
 
 int main(int argc, char *argv[]) {
-	int i, o, ret;
+	int i, o, ret, fd;
 	char s[] = "  test string with some whitespace  ";
 	struct foo foo_instance;
 	struct timespec t, a;
@@ -157,4 +163,38 @@ int main(int argc, char *argv[]) {
 	/* PKLINES() will produce a nice looking multi-line block of text, and
 	 * shares many characteristics with PKDUMP() */
 	PKLINES("test block\n\nof\ntext", 128, "this is a multi-line string");
+
+	/* --- registry messages --- */
+
+	/* PKRSTART() starts a reporter thread that prints a snapshot of every
+	 * registered entry on request. Here, sending SIGUSR1 to the process (e.g:
+	 * `kill -USR1 ${pid}`) or writing a byte to the returned fd will do that,
+	 * without blocking the threads that are updating the entries. The fd is
+	 * owned by the caller, and should be closed when it is no longer needed
+	 */
+	fd = PKRSTART(SIGUSR1);
+
+	/* PKRACC(), PKRCNT() and PKRRATE() update named entries without producing
+	 * any output, so they are suitable for long-running loops
+	 */
+	for (o = 0; o < 5; o++) {
+		PKTSTART(t);
+		usleep(1000);
+		PKRACC(t, work_time);
+		PKRCNT(work_items, 2);
+		PKRRATE(t, work_rate, 2);
+	}
+
+	/* PKRSNAP() prints a snapshot immediately, from the calling thread
+	 */
+	PKRSNAP();
+
+	/* request a snapshot from the reporter thread by writing to the fd, and
+	 * give it time to print before exiting. This is the last output, so the
+	 * order of the log doesn't depend on the reporter thread
+	 */
+	if (write(fd, "", 1) != 1) PKE("write() failed");
+	usleep(10000);
+
+	close(fd);
 }
@@ -60,6 +60,16 @@
 # define PK_BSTR_WIDTH 64
 #endif
 
+/* Optionally define PK_REG to enable the named registry of accumulators,
+ * counters and rates (userspace only). This pulls in pthreads, so the
+ * application must be linked with -pthread. The values are updated with 64-bit
+ * atomics, so 32-bit targets without native support (e.g: ARMv6) must also be
+ * linked with -latomic.
+ */
+#if defined(PK_REG) && (defined(__KERNEL__) || defined(__ZEPHYR__))
+# error "PK_REG is only supported in userspace"
+#endif
+
 /* -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=-
  * INTERNAL / SUPPORT:
  */
@@ -389,6 +399,291 @@ static inline const char *_pk_nextchunk(const char *buf, size_t len, const char
 #define PKTRAWS(ts, str)          _PKT("TRAWS(" #ts ")", ts, ": %s", str)
 #define PKTRAWF(ts, fmt, args...) _PKT("TRAWF(" #ts ")", ts, ": " fmt, ##args)
 
+/* -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=-
+ * REGISTRY MESSAGES:
+ */
+#ifdef PK_REG
+
+# include <fcntl.h>
+# include <pthread.h>
+# include <signal.h>
+# include <unistd.h>
+
+/* A registry entry. Entries are declared with PKRDEF(), and are added to the
+ * registry by the first PKRACC(), PKRCNT() or PKRRATE() that touches them. The
+ * members should not be accessed directly from user code.
+ */
+struct pk_reg {
+	const char *name;
+	const char *fl;
+	const char *fn;
+	int type;
+	int state;
+	uint64_t n;
+	uint64_t ns;
+	struct pk_reg *next;
+};
+
+#define _PK_REG_ACC  1
+#define _PK_REG_CNT  2
+#define _PK_REG_RATE 3
+
+/* The registry itself is a singly-linked list that entries are appended to, and
+ * are never removed from. `_pk_reg_tail` points at the last `next` member (or
+ * the head) so that entries appear in the order they were registered. These
+ * are weak so that every translation unit that includes this header shares the
+ * same instance.
+ */
+__attribute__((weak)) struct pk_reg *_pk_reg_head = NULL;
+__attribute__((weak)) struct pk_reg **_pk_reg_tail = &_pk_reg_head;
+__attribute__((weak)) int _pk_reg_rfd = -1;
+__attribute__((weak)) int _pk_reg_wfd = -1;
+__attribute__((weak)) int _pk_reg_atfork = 0;
+__attribute__((weak)) pthread_once_t _pk_reg_once = PTHREAD_ONCE_INIT;
+
+/* This function adds an entry to the registry. Only the first caller will
+ * record the type and location, so an entry's location is that of the first
+ * update. It should not be used from user code.
+ */
+static inline void _pk_reg_add(struct pk_reg *e, int type, const char *_pkfl, const char *_pkfn) {
+	struct pk_reg **prev;
+	int s = 0;
+
+	if (!__atomic_compare_exchange_n(&e->state, &s, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) return;
+
+	e->type = type; e->fl = _pkfl; e->fn = _pkfn; e->next = NULL;
+
+	/* claim the tail, and then link the entry in - a concurrent snapshot may
+	 * briefly stop short of entries that are still being linked
+	 */
+	prev = __atomic_exchange_n(&_pk_reg_tail, &e->next, __ATOMIC_ACQ_REL);
+	__atomic_store_n(prev, e, __ATOMIC_RELEASE);
+}
+
+/* This function prints every registered entry. Values are read with relaxed
+ * atomic loads, so the updating threads are never blocked, but a snapshot is
+ * not a consistent cut across entries (or between `n` and `t` of one entry).
+ * PK_FUNC must be called directly to show the location of each entry.
+ */
+static inline void _pk_reg_snap(void) {
+	struct pk_reg *e;
+	unsigned long long n;
+	uint64_t ns;
+
+	for (e = __atomic_load_n(&_pk_reg_head, __ATOMIC_ACQUIRE); e != NULL; e = __atomic_load_n(&e->next, __ATOMIC_ACQUIRE)) {
+		n  = __atomic_load_n(&e->n,  __ATOMIC_RELAXED);
+		ns = __atomic_load_n(&e->ns, __ATOMIC_RELAXED);
+
+		switch (e->type) {
+			case _PK_REG_ACC:
+				PK_FUNC(PK_TAG ": %s %s(): RACC(%s) @ %ld.%09ld, n=%llu",
+					e->fl, e->fn, e->name,
+					(long)(ns / 1000000000), (long)(ns % 1000000000), n
+				);
+				break;
+			case _PK_REG_CNT:
+				PK_FUNC(PK_TAG ": %s %s(): RCNT(%s), n=%llu",
+					e->fl, e->fn, e->name, n
+				);
+				break;
+			case _PK_REG_RATE:
+				PK_FUNC(PK_TAG ": %s %s(): RRATE(%s), n=%llu, t=%ld.%09ld, f=%1.3f Hz",
+					e->fl, e->fn, e->name, n,
+					(long)(ns / 1000000000), (long)(ns % 1000000000),
+					(ns == 0) ? 0.0 : (n / (ns / 1000000000.0))
+				);
+				break;
+		}
+	}
+}
+
+#define PKRSNAP()                                    \
+  {                                                  \
+    PKF("REG: ---8<---[ snapshot begins ]---8<---"); \
+    _pk_reg_snap();                                  \
+    PKF("REG: ---8<---[  snapshot ends  ]---8<---"); \
+  }
+
+/* These functions implement the reporter thread, which prints a snapshot each
+ * time that data arrives on the control pipe, and the signal handler, which
+ * only writes to the control pipe. They should not be used from user code.
+ */
+static inline void *_pk_reg_thread(void *arg) {
+	int fd = (int)(intptr_t)arg;
+	char buf[64];
+	ssize_t r;
+
+	for (;;) {
+		/* a burst of requests is coalesced into a single snapshot */
+		r = read(fd, buf, sizeof(buf));
+		if (r > 0) { PKRSNAP(); continue; }
+		if ((r < 0) && (errno == EINTR)) continue;
+		break;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static inline void _pk_reg_sig(int sig) {
+	int _e = errno;
+	ssize_t r;
+
+	/* if the pipe is full, then a snapshot is already pending */
+	r = write(__atomic_load_n(&_pk_reg_wfd, __ATOMIC_ACQUIRE), "", 1);
+
+	(void)sig; (void)r;
+	errno = _e;
+}
+
+/* The reporter thread is not inherited by a child process, so the child closes
+ * its copies of the control pipe, and re-arms startup - the child must call
+ * PKRSTART() to start its own reporter thread. Until it does, the inherited
+ * signal handler does nothing.
+ */
+static inline void _pk_reg_child(void) {
+	pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	if (_pk_reg_rfd >= 0) close(_pk_reg_rfd);
+	if (_pk_reg_wfd >= 0) close(_pk_reg_wfd);
+
+	_pk_reg_rfd = -1;
+	_pk_reg_wfd = -1;
+	_pk_reg_once = once;
+}
+
+static inline void _pk_reg_init(void) {
+	int fds[2], ret;
+	pthread_t t;
+
+	/* handlers are inherited by a child, so only register them once */
+	if (!_pk_reg_atfork) {
+		if ((ret = pthread_atfork(NULL, NULL, _pk_reg_child)) != 0) {
+			errno = ret;
+			PKE("REG: pthread_atfork() failed");
+			return;
+		}
+		_pk_reg_atfork = 1;
+	}
+
+	if (pipe(fds) != 0) {
+		PKE("REG: pipe() failed");
+		return;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+	if ((ret = pthread_create(&t, NULL, _pk_reg_thread, (void *)(intptr_t)fds[0])) != 0) {
+		errno = ret;
+		PKE("REG: pthread_create() failed");
+		close(fds[0]); close(fds[1]);
+		return;
+	}
+	pthread_detach(t);
+
+	_pk_reg_rfd = fds[0];
+	__atomic_store_n(&_pk_reg_wfd, fds[1], __ATOMIC_RELEASE);
+}
+
+/* This function starts the reporter thread on the first call only, but will
+ * install the signal handler on every call. The internal write end is never
+ * handed out - the caller receives a duplicate that they own, and may close.
+ */
+static inline int _pk_reg_start(int sig) {
+	int fd;
+	struct sigaction sa;
+
+	pthread_once(&_pk_reg_once, _pk_reg_init);
+	if ((fd = __atomic_load_n(&_pk_reg_wfd, __ATOMIC_ACQUIRE)) < 0) return -1;
+
+	if (sig != 0) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = _pk_reg_sig;
+#ifdef SA_RESTART
+		/* SA_RESTART is XSI, and isn't available at a strict POSIX level */
+		sa.sa_flags = SA_RESTART;
+#endif
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(sig, &sa, NULL) != 0) PKE("REG: sigaction(%d) failed", sig);
+	}
+
+	if ((fd = fcntl(fd, F_DUPFD, 0)) < 0) {
+		PKE("REG: fcntl(F_DUPFD) failed");
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	return fd;
+}
+
+/* This macro takes care of registering an entry on its first update, and then
+ * atomically adding to its values. It should not be used from user code.
+ */
+#define _PKRADD(var, type, cnt, nsec)                             \
+  {                                                               \
+    if (__atomic_load_n(&(var).state, __ATOMIC_RELAXED) == 0)     \
+      _pk_reg_add(&(var), type, _PKFL, __func__);                 \
+    __atomic_fetch_add(&(var).n, (cnt), __ATOMIC_RELAXED);        \
+    if ((nsec) != 0)                                              \
+      __atomic_fetch_add(&(var).ns, (nsec), __ATOMIC_RELAXED);    \
+  }
+
+#define _PKTNS(ts) (((uint64_t)(ts).tv_sec * 1000000000) + (uint64_t)(ts).tv_nsec)
+
+/* These macros are the intended public interface for the registry, and should
+ * be used from within your application. Unlike PKTACC() and friends, updates
+ * produce no output, and only cost a few atomic operations - the totals are
+ * printed on demand with PKRSNAP(), or by the reporter thread.
+ *
+ *   - PKRDEF()   - Define a registry entry named `var`, at file or function
+ *                  scope. The entry always has static storage, as it remains
+ *                  on the registry for the life of the process, and does not
+ *                  warn if it is never updated (e.g: behind #ifdef). An entry
+ *                  must only be used with one of PKRACC(), PKRCNT() or
+ *                  PKRRATE(), and is registered by its first update.
+ *   - PKRACC()   - Accumulate the difference in time between a previously
+ *                  acquired timestamp `ts`, and "now" into `var`. "RACC" is
+ *                  present in the snapshot, along with the number of updates.
+ *   - PKRCNT()   - Add `n` to the counter `var`. "RCNT" is present in the
+ *                  snapshot.
+ *   - PKRRATE()  - Add `n` items, and the difference in time between `ts` and
+ *                  "now" to `var`. "RRATE" is present in the snapshot, along
+ *                  with the overall frequency.
+ *   - PKRSNAP()  - Print a snapshot of all registered entries from the calling
+ *                  thread. The snapshot will be wrapped with cut marks, and
+ *                  each entry is reported at the location of its first update.
+ *                  Entries are listed in the order they were registered.
+ *   - PKRSTART() - Start the reporter thread if it is not already running, and
+ *                  if `sig` is non-zero (e.g: SIGUSR1), install a handler for
+ *                  it that requests a snapshot. It may be called more than once
+ *                  to install handlers for several signals. The result is a new
+ *                  control fd that the caller owns, or -1 on error - writing
+ *                  any byte to it will request a snapshot, and it should be
+ *                  closed once it is no longer needed. After fork(), the child
+ *                  must call PKRSTART() again to start its own reporter thread
+ *                  - fds from the parent's PKRSTART() should not be used.
+ */
+#define PKRDEF(var) static struct pk_reg var __attribute__((unused)) = { .name = #var }
+
+#define PKRACC(ts, var)                               \
+  {                                                   \
+    struct timespec _t; _PKTDIFF(ts, _t);             \
+    _PKRADD(var, _PK_REG_ACC, 1, _PKTNS(_t));         \
+  }
+
+#define PKRCNT(var, n) _PKRADD(var, _PK_REG_CNT, n, 0)
+
+#define PKRRATE(ts, var, n)                           \
+  {                                                   \
+    struct timespec _t; _PKTDIFF(ts, _t);             \
+    _PKRADD(var, _PK_REG_RATE, n, _PKTNS(_t));        \
+  }
+
+#define PKRSTART(sig) _pk_reg_start(sig)
+
+#endif /* PK_REG */
+
 /* -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=- -=#=-
  * HEX-DUMP MESSAGES:
  */